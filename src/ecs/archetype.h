@@ -1,21 +1,40 @@
 #pragma once
 
 #include <set>
+#include <map>
+#include <span>
 #include <vector>
 #include <unordered_map>
 #include <functional>
+#include <iterator>
 #include "ecs/component_id.h"
 #include "ecs/ecs_id.h"
+#include "ecs/double_buffered.h"
 
 namespace mkr {
     typedef std::set<component_id_t> archetype_t;
+    /// For each shared component type of an archetype, the slot of its value in the world's shared_store.
+    typedef std::map<component_id_t, std::size_t> shared_t;
+    /// Archetypes are partitioned by both their component types and their shared component values.
+    typedef std::pair<archetype_t, shared_t> archetype_key_t;
+    /// Called by archetype::swap_buffers with each double buffered component type, and the entities whose rows of it were written since the previous swap.
+    typedef std::function<void(component_id_t, std::span<const ecs_id_t>)> written_func_t;
 
     class archetype {
     private:
         /// A set containing the component type ids of this archetype.
         archetype_t types_;
+        /// The shared component values of this archetype. Every entity of this archetype has these values.
+        shared_t shared_;
         /// A 2D array containing the components of this archetype.
         std::vector<void*> components_;
+        /// The back buffers of double buffered components, or nullptr for components which are not double buffered.
+        std::vector<void*> back_components_;
+        /**
+         * For each row of a double buffered component, has it been written since the last swap_buffers? nullptr for components which are not double buffered.
+         * This is not a std::vector<bool>, so that concurrent writers of different rows never write to the same byte.
+         */
+        std::vector<std::vector<unsigned char>*> written_;
         /// For each component type of this archetype, what is its array index in components_?
         std::unordered_map<component_id_t, std::size_t> component_to_index_;
         /**
@@ -25,6 +44,8 @@ namespace mkr {
          */
         std::unordered_map<ecs_id_t, std::size_t> entity_to_index_;
         std::vector<ecs_id_t> index_to_entity_;
+        /// Incremented whenever the address of any component in this archetype may have changed.
+        std::size_t version_ = 0;
 
         // Helper functions.
         std::vector<std::function<void()>> destroy_funcs_; // Delete arrays.
@@ -33,6 +54,9 @@ namespace mkr {
         std::vector<std::function<void()>> pop_back_funcs_; // Remove the last element in the arrays.
         std::vector<std::function<void(archetype*)>> create_funcs_; // Create arrays.
         std::vector<std::function<void(ecs_id_t, archetype*)>> copy_funcs_; // Copy components of an entity to another archetype.
+        std::vector<std::function<void(std::size_t, std::size_t)>> clone_funcs_; // Append n copies of an element to the arrays.
+        std::vector<std::function<void(archetype*)>> splice_funcs_; // Move all elements of another archetype's arrays to the end of the arrays.
+        std::vector<std::function<void(const written_func_t&)>> flip_funcs_; // Swap the front and back buffers of double buffered arrays.
 
         archetype() {}
 
@@ -45,21 +69,87 @@ namespace mkr {
             auto comp_idx = components_.size();
             component_to_index_[comp_id] = comp_idx;
 
-            // Create array.
+            // Create arrays. Double buffered components get a second array as their back buffer.
             auto arr = new std::vector<T>();
+            auto back_arr = double_buffered_v<T> ? new std::vector<T>() : nullptr;
+            auto written = double_buffered_v<T> ? new std::vector<unsigned char>() : nullptr;
             components_.push_back(arr);
+            back_components_.push_back(back_arr);
+            written_.push_back(written);
+            std::vector<std::vector<T>*> arrs{arr};
+            if (back_arr) { arrs.push_back(back_arr); }
 
             // Helper functions.
-            destroy_funcs_.push_back([arr]() { delete arr; });
-            append_funcs_.push_back([arr]() { arr->push_back(T{}); });
-            swap_funcs_.push_back([arr](std::size_t _a, std::size_t _b) { std::swap((*arr)[_a], (*arr)[_b]); });
-            pop_back_funcs_.push_back([arr]() { arr->pop_back(); });
+            destroy_funcs_.push_back([arrs, written]() {
+                for (auto a : arrs) { delete a; }
+                delete written;
+            });
+            append_funcs_.push_back([arrs, written]() {
+                for (auto a : arrs) { a->push_back(T{}); }
+                if (written) { written->push_back(0); }
+            });
+            swap_funcs_.push_back([arrs, written](std::size_t _a, std::size_t _b) {
+                for (auto a : arrs) { std::swap((*a)[_a], (*a)[_b]); }
+                if (written) { std::swap((*written)[_a], (*written)[_b]); }
+            });
+            pop_back_funcs_.push_back([arrs, written]() {
+                for (auto a : arrs) { a->pop_back(); }
+                if (written) { written->pop_back(); }
+            });
+            clone_funcs_.push_back([arrs, written](std::size_t _src, std::size_t _n) {
+                // Copy-construct the new elements in place, without value-initialising them first.
+                for (auto a : arrs) {
+                    const T prefab = (*a)[_src];
+                    a->insert(a->end(), _n, prefab);
+                }
+                if (written) { written->insert(written->end(), _n, (*written)[_src]); }
+            });
+            splice_funcs_.push_back([this](archetype* _src) {
+                // Trivially copyable elements are moved with a single memmove.
+                auto splice_arr = [](std::vector<T>& _dst_arr, std::vector<T>& _src_arr) {
+                    _dst_arr.insert(_dst_arr.end(), std::make_move_iterator(_src_arr.begin()), std::make_move_iterator(_src_arr.end()));
+                    _src_arr.clear();
+                };
+                splice_arr(this->casted_arr<T>(), _src->casted_arr<T>());
+                if constexpr (double_buffered_v<T>) {
+                    splice_arr(this->casted_back_arr<T>(), _src->casted_back_arr<T>());
+                    auto& dst_written = this->casted_written<T>();
+                    auto& src_written = _src->casted_written<T>();
+                    dst_written.insert(dst_written.end(), src_written.begin(), src_written.end());
+                    src_written.clear();
+                }
+            });
             create_funcs_.push_back([](archetype* _arc) { _arc->create_array<T>(); });
             copy_funcs_.push_back([this](ecs_id_t _entity, archetype* _dst) {
                 if (_dst->has_type<T>()) { // There is a chance we're moving to an archetype with fewer types, such as when removing components.
-                    _dst->set<T>(_entity, this->get<T>(_entity));
+                    const std::size_t src_idx = this->entity_to_index_.find(_entity)->second;
+                    const std::size_t dst_idx = _dst->entity_to_index_.find(_entity)->second;
+                    _dst->casted_arr<T>()[dst_idx] = this->casted_arr<T>()[src_idx];
+                    if constexpr (double_buffered_v<T>) {
+                        _dst->casted_back_arr<T>()[dst_idx] = this->casted_back_arr<T>()[src_idx];
+                        _dst->casted_written<T>()[dst_idx] = this->casted_written<T>()[src_idx];
+                    }
                 }
             });
+            if constexpr (double_buffered_v<T>) {
+                flip_funcs_.push_back([this, comp_id, comp_idx](const written_func_t& _on_written) {
+                    // Carry the rows that were not written forward, so that the new front buffer holds the latest value of every row.
+                    auto& front = *static_cast<std::vector<T>*>(components_[comp_idx]);
+                    auto& back = *static_cast<std::vector<T>*>(back_components_[comp_idx]);
+                    auto& written = *written_[comp_idx];
+                    std::vector<ecs_id_t> written_ents;
+                    for (std::size_t i = 0; i < written.size(); ++i) {
+                        if (written[i]) {
+                            written[i] = 0;
+                            if (_on_written) { written_ents.push_back(index_to_entity_[i]); }
+                        } else {
+                            back[i] = front[i];
+                        }
+                    }
+                    std::swap(components_[comp_idx], back_components_[comp_idx]);
+                    if (_on_written && !written_ents.empty()) { _on_written(comp_id, written_ents); }
+                });
+            }
         }
 
         template<typename T, typename U, typename ...Args>
@@ -81,6 +171,24 @@ namespace mkr {
             return *static_cast<std::vector<T>*>(components_[comp_idx]);
         }
 
+        template<typename T>
+        std::vector<T>& casted_back_arr() {
+            const std::size_t comp_idx = component_to_index_.find(component_id::value<T>())->second;
+            return *static_cast<std::vector<T>*>(back_components_[comp_idx]);
+        }
+
+        template<typename T>
+        const std::vector<T>& casted_back_arr() const {
+            const std::size_t comp_idx = component_to_index_.find(component_id::value<T>())->second;
+            return *static_cast<std::vector<T>*>(back_components_[comp_idx]);
+        }
+
+        template<typename T>
+        std::vector<unsigned char>& casted_written() {
+            const std::size_t comp_idx = component_to_index_.find(component_id::value<T>())->second;
+            return *written_[comp_idx];
+        }
+
     public:
         template<typename T, typename ...Args>
         static archetype* make() {
@@ -99,6 +207,18 @@ namespace mkr {
 
         const archetype_t& types() const { return types_; }
 
+        const shared_t& shared() const { return shared_; }
+
+        archetype_key_t key() const { return archetype_key_t{types_, shared_}; }
+
+        template<typename T>
+        bool has_shared() const { return shared_.contains(component_id::value<T>()); }
+
+        template<typename T>
+        std::size_t shared_slot() const { return shared_.find(component_id::value<T>())->second; }
+
+        std::size_t size() const { return index_to_entity_.size(); }
+
         template<typename T>
         bool has_type() const { return types_.contains(component_id::value<T>()); }
 
@@ -108,19 +228,105 @@ namespace mkr {
             return casted_arr<T>()[ent_idx];
         }
 
+        /// Returns the last value written with set. For components that are not double buffered, this is the same as get.
+        template<typename T>
+        const T& get_back(ecs_id_t _entity) const {
+            if constexpr (double_buffered_v<T>) {
+                const std::size_t ent_idx = entity_to_index_.find(_entity)->second;
+                return casted_back_arr<T>()[ent_idx];
+            } else {
+                return get<T>(_entity);
+            }
+        }
+
+        /**
+         * Double buffered components are written to their back buffer, and can only be read with get after swap_buffers.
+         * This is safe to call concurrently with get, and with set on other entities, as long as the archetype is not changed structurally at the same time.
+         */
         template<typename T>
         void set(ecs_id_t _entity, const T& _component) {
             const std::size_t ent_idx = entity_to_index_.find(_entity)->second;
-            casted_arr<T>()[ent_idx] = _component;
+            if constexpr (double_buffered_v<T>) {
+                const std::size_t comp_idx = component_to_index_.find(component_id::value<T>())->second;
+                (*static_cast<std::vector<T>*>(back_components_[comp_idx]))[ent_idx] = _component;
+                (*written_[comp_idx])[ent_idx] = 1;
+            } else {
+                casted_arr<T>()[ent_idx] = _component;
+            }
+        }
+
+        /**
+         * Make the values written since the last swap readable, by swapping the front and back buffers of every double buffered component.
+         * Rows that were not written keep their value, which is copied into the new front buffer. Rows that were written are not copied.
+         * Swapping the buffers is O(1), but checking and carrying forward the rows is O(rows) per double buffered component.
+         * If _on_written is set, it is called after each component is swapped, with the entities whose rows were written.
+         * Call this once per frame, when no system is running.
+         */
+        void swap_buffers(const written_func_t& _on_written = {}) {
+            if (flip_funcs_.empty()) { return; }
+            ++version_;
+            for (const auto& f : flip_funcs_) { f(_on_written); }
         }
 
         void add(ecs_id_t _entity) {
+            ++version_;
             index_to_entity_.push_back(_entity);
             entity_to_index_.insert(std::pair(_entity, entity_to_index_.size()));
             for (const auto& f : append_funcs_) { f(); }
         }
 
+        /**
+         * Append the entities in _entities to this archetype, copying every component of _prefab to them.
+         * _prefab must already be in this archetype.
+         */
+        void clone(ecs_id_t _prefab, const std::vector<ecs_id_t>& _entities) {
+            if (_entities.empty()) { return; }
+
+            ++version_;
+            const std::size_t src_idx = entity_to_index_.find(_prefab)->second;
+            index_to_entity_.reserve(index_to_entity_.size() + _entities.size());
+            entity_to_index_.reserve(entity_to_index_.size() + _entities.size());
+            for (const auto& e : _entities) {
+                entity_to_index_.insert(std::pair(e, index_to_entity_.size()));
+                index_to_entity_.push_back(e);
+            }
+            for (const auto& f : clone_funcs_) { f(src_idx, _entities.size()); }
+        }
+
+        /**
+         * Move every entity of _src, which must have the same component types, to the end of this archetype, leaving _src empty.
+         * _entities[i] is the id that the entity in row i of _src has in this archetype.
+         */
+        void splice(archetype* _src, const std::vector<ecs_id_t>& _entities) {
+            ++version_;
+            ++_src->version_;
+            index_to_entity_.reserve(index_to_entity_.size() + _entities.size());
+            entity_to_index_.reserve(entity_to_index_.size() + _entities.size());
+            for (const auto& e : _entities) {
+                entity_to_index_.insert(std::pair(e, index_to_entity_.size()));
+                index_to_entity_.push_back(e);
+            }
+            for (const auto& f : splice_funcs_) { f(_src); }
+
+            _src->index_to_entity_.clear();
+            _src->entity_to_index_.clear();
+        }
+
+        /**
+         * Give every entity of this archetype a new id and new shared component values.
+         * _entities[i] is the new id of the entity in row i.
+         */
+        void rename(const std::vector<ecs_id_t>& _entities, const shared_t& _shared) {
+            ++version_;
+            index_to_entity_ = _entities;
+            entity_to_index_.clear();
+            entity_to_index_.reserve(_entities.size());
+            for (std::size_t i = 0; i < _entities.size(); ++i) { entity_to_index_.insert(std::pair(_entities[i], i)); }
+            shared_ = _shared;
+        }
+
         void remove(ecs_id_t _entity) {
+            ++version_;
             auto rm_iter = entity_to_index_.find(_entity);
             const std::size_t rm_idx = rm_iter->second;
             const std::size_t last_idx = entity_to_index_.size() - 1;
@@ -141,11 +347,42 @@ namespace mkr {
 
         bool has_entity(ecs_id_t _entity) const { return entity_to_index_.contains(_entity); }
 
+        const std::vector<ecs_id_t>& entities() const { return index_to_entity_; }
+
+        /// The structural version of this archetype. Pointers returned by find are valid for as long as this does not change.
+        std::size_t version() const { return version_; }
+
+        /// Returns a pointer to the component of _entity, which stays valid until version() changes, or nullptr if the entity is not in this archetype.
+        template<typename T>
+        const T* find(ecs_id_t _entity) const {
+            auto iter = entity_to_index_.find(_entity);
+            return iter == entity_to_index_.end() ? nullptr : &casted_arr<T>()[iter->second];
+        }
+
         template<typename T>
         archetype* branch_to() const {
             auto arc = new archetype();
             for (const auto& f : create_funcs_) { f(arc); }
             arc->create_array<T>();
+            arc->shared_ = shared_;
+            return arc;
+        }
+
+        template<typename T>
+        archetype* prune_to() const {
+            auto arc = new archetype();
+            for (const auto& [comp_id, comp_idx] : component_to_index_) {
+                if (comp_id != component_id::value<T>()) { create_funcs_[comp_idx](arc); }
+            }
+            arc->shared_ = shared_;
+            return arc;
+        }
+
+        /// Create an archetype with the same component types as this one, but with different shared component values.
+        archetype* partition_to(const shared_t& _shared) const {
+            auto arc = new archetype();
+            for (const auto& f : create_funcs_) { f(arc); }
+            arc->shared_ = _shared;
             return arc;
         }
 
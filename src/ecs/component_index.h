@@ -0,0 +1,135 @@
+#pragma once
+
+#include <map>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include "ecs/ecs_id.h"
+#include "ecs/archetype.h"
+
+namespace mkr {
+    /// A secondary index over the values of a component type, kept up to date by the world.
+    class component_index {
+    public:
+        virtual ~component_index() {}
+
+        /// Insert _entity, or update it if it is already indexed, using its component in _arc. Double buffered components are keyed by their front buffer.
+        virtual void insert(ecs_id_t _entity, const archetype* _arc) = 0;
+        virtual void erase(ecs_id_t _entity) = 0;
+        /// Is the indexed component double buffered? If so, the world re-keys the index whenever it swaps buffers.
+        virtual bool double_buffered() const = 0;
+    };
+
+    /// An index for equality lookups on a key computed from component T.
+    template<typename T, typename K>
+    class hash_index : public component_index {
+    private:
+        struct entry {
+            K key_;
+            /// The position of the entity in key_to_ents_[key_].
+            std::size_t pos_;
+        };
+
+        std::function<K(const T&)> key_func_;
+        std::unordered_map<K, std::vector<ecs_id_t>> key_to_ents_;
+        std::unordered_map<ecs_id_t, entry> ent_to_entry_;
+
+    public:
+        explicit hash_index(std::function<K(const T&)> _key_func) : key_func_(std::move(_key_func)) {}
+        virtual ~hash_index() {}
+
+        bool double_buffered() const override { return double_buffered_v<T>; }
+
+        void insert(ecs_id_t _entity, const archetype* _arc) override {
+            K key = key_func_(_arc->get<T>(_entity));
+
+            // If the key has not changed, do nothing.
+            if (auto iter = ent_to_entry_.find(_entity); iter != ent_to_entry_.end()) {
+                if (iter->second.key_ == key) { return; }
+                erase(_entity);
+            }
+
+            auto& ents = key_to_ents_[key];
+            ent_to_entry_.insert(std::pair(_entity, entry{std::move(key), ents.size()}));
+            ents.push_back(_entity);
+        }
+
+        void erase(ecs_id_t _entity) override {
+            auto iter = ent_to_entry_.find(_entity);
+            if (iter == ent_to_entry_.end()) { return; }
+
+            // Swap the entity with the last entity of the same key, then remove it.
+            auto ents_iter = key_to_ents_.find(iter->second.key_);
+            auto& ents = ents_iter->second;
+            const std::size_t pos = iter->second.pos_;
+            if (pos != ents.size() - 1) {
+                ents[pos] = ents.back();
+                ent_to_entry_.find(ents[pos])->second.pos_ = pos;
+            }
+            ents.pop_back();
+            if (ents.empty()) { key_to_ents_.erase(ents_iter); }
+            ent_to_entry_.erase(iter);
+        }
+
+        /// Returns an entity whose key equals _key, or ecs_id::invalid_id if there is none.
+        ecs_id_t find_one(const K& _key) const {
+            auto iter = key_to_ents_.find(_key);
+            return iter == key_to_ents_.end() ? ecs_id::invalid_id : iter->second.front();
+        }
+
+        /// Returns all entities whose key equals _key.
+        std::vector<ecs_id_t> find(const K& _key) const {
+            auto iter = key_to_ents_.find(_key);
+            return iter == key_to_ents_.end() ? std::vector<ecs_id_t>{} : iter->second;
+        }
+
+        std::size_t size() const { return ent_to_entry_.size(); }
+    };
+
+    /// An index for ordered range lookups on a key computed from component T.
+    template<typename T, typename K>
+    class sorted_index : public component_index {
+    private:
+        std::function<K(const T&)> key_func_;
+        std::multimap<K, ecs_id_t> key_to_ent_;
+        /// Multimap iterators stay valid until their element is erased, so each entity remembers its node.
+        std::unordered_map<ecs_id_t, typename std::multimap<K, ecs_id_t>::iterator> ent_to_iter_;
+
+    public:
+        explicit sorted_index(std::function<K(const T&)> _key_func) : key_func_(std::move(_key_func)) {}
+        virtual ~sorted_index() {}
+
+        bool double_buffered() const override { return double_buffered_v<T>; }
+
+        void insert(ecs_id_t _entity, const archetype* _arc) override {
+            K key = key_func_(_arc->get<T>(_entity));
+
+            // If the key has not changed, do nothing.
+            if (auto iter = ent_to_iter_.find(_entity); iter != ent_to_iter_.end()) {
+                const K& old_key = iter->second->first;
+                if (!(old_key < key) && !(key < old_key)) { return; }
+                erase(_entity);
+            }
+
+            ent_to_iter_.insert(std::pair(_entity, key_to_ent_.insert(std::pair(std::move(key), _entity))));
+        }
+
+        void erase(ecs_id_t _entity) override {
+            auto iter = ent_to_iter_.find(_entity);
+            if (iter == ent_to_iter_.end()) { return; }
+            key_to_ent_.erase(iter->second);
+            ent_to_iter_.erase(iter);
+        }
+
+        /// Returns all entities whose key is in [_lo, _hi], ordered by key.
+        std::vector<ecs_id_t> range(const K& _lo, const K& _hi) const {
+            std::vector<ecs_id_t> ents;
+            for (auto iter = key_to_ent_.lower_bound(_lo); iter != key_to_ent_.end() && !(_hi < iter->first); ++iter) {
+                ents.push_back(iter->second);
+            }
+            return ents;
+        }
+
+        std::size_t size() const { return ent_to_iter_.size(); }
+    };
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "ecs/world.h"
+
+namespace mkr {
+    /**
+     * A reference to component T of an entity, for repeatedly reading the same component.
+     * The archetype, address and version of the component are cached, so a read is a version check and a dereference.
+     * If the archetype has changed since, such as when an entity is added, removed or moved, the component is looked up again.
+     * A component_ref must not outlive its world.
+     */
+    template<typename T>
+    class component_ref {
+    private:
+        const world* world_;
+        ecs_id_t entity_;
+        mutable const archetype* arc_ = nullptr;
+        mutable std::size_t version_ = 0;
+        mutable const T* component_ = nullptr;
+
+        void resolve() const {
+            // Ensure that entity exists and has component.
+            if (!world_->has_component<T>(entity_)) {
+                throw missing_component();
+            }
+
+            arc_ = world_->ent_to_arc_.find(entity_)->second;
+            version_ = arc_->version();
+            component_ = arc_->find<T>(entity_);
+        }
+
+    public:
+        component_ref(const world& _world, ecs_id_t _entity) : world_(&_world), entity_(_entity) {}
+
+        ecs_id_t entity() const { return entity_; }
+
+        /// Double buffered components are read from their front buffer. Throws missing_component if the entity no longer has the component.
+        const T& get() const {
+            if (!arc_ || arc_->version() != version_) { resolve(); }
+            return *component_;
+        }
+
+        const T& operator*() const { return get(); }
+        const T* operator->() const { return &get(); }
+    };
+}
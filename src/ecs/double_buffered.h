@@ -0,0 +1,17 @@
+#pragma once
+
+#include <type_traits>
+
+namespace mkr {
+    /**
+     * Specialise this to std::true_type to double buffer component T.
+     * A double buffered component has a front buffer, which is read, and a back buffer, which is written.
+     * The buffers are swapped by archetype::swap_buffers, so readers and writers of T can run concurrently without locks.
+     * The swap itself is O(1), but rows that were not written since the last swap are copied forward, so a swap costs O(rows) of T.
+     */
+    template<typename T>
+    struct double_buffered : std::false_type {};
+
+    template<typename T>
+    inline constexpr bool double_buffered_v = double_buffered<T>::value;
+}
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include "ecs/ecs_id.h"
 
 namespace mkr {
@@ -49,6 +50,7 @@ namespace mkr {
 
         // Update linked list of recyclable ids.
         next_index_ = index_of(ids_[next_index_]);
+        --num_free_;
 
         // Update master list.
         ids_[index] = index | generation | flags;
@@ -76,6 +78,27 @@ namespace mkr {
         return recycle_old_id();
     }
 
+    std::vector<ecs_id_t> ecs_id::create_ids(std::size_t _n) {
+        std::vector<ecs_id_t> ids;
+        ids.reserve(_n);
+
+        // Case 1: Recycle old ids first.
+        while (ids.size() < _n && ECS_MAX_INDEX != next_index_) {
+            ids.push_back(recycle_old_id());
+        }
+
+        // Case 2: Generate the remaining ids as one contiguous block of indices.
+        const ecs_id_t num_new = std::min<ecs_id_t>(_n - ids.size(), ECS_MAX_INDEX - id_counter_);
+        for (ecs_id_t index = id_counter_; index < id_counter_ + num_new; ++index) {
+            ids_[index] = index;
+            ids.push_back(index);
+        }
+        id_counter_ += num_new;
+        num_alive_ += num_new;
+
+        return ids;
+    }
+
     bool ecs_id::destroy_id(ecs_id_t _id) {
         // Check if the id is valid.
         if (!is_valid(_id)) { return false; }
@@ -89,6 +112,7 @@ namespace mkr {
             // At this point, if this is the first element in the linked list, next_index_ is guaranteed to be ECS_MAX_INDEX.
             ids_[index] = next_index_ | (next_generation << ECS_GENERATION_BIT_OFFSET);
             next_index_ = index;
+            ++num_free_;
         }
         // Else, set its generation to ECS_MAX_GENERATION.
         else {
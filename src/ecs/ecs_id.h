@@ -2,6 +2,7 @@
 
 #include <cstdint>
 #include <cstring>
+#include <vector>
 
 namespace mkr {
     // Flags (Currently Unused)
@@ -73,6 +74,8 @@ namespace mkr {
         ecs_id_t id_counter_ = 0;
         /// Used to count the number of alive ids.
         std::size_t num_alive_ = 0;
+        /// Used to count the number of ids in the linked list of recyclable ids.
+        std::size_t num_free_ = 0;
 
         ecs_id_t set_flag(ecs_id_t _index, ecs_id_t _flag);
         ecs_id_t reset_flag(ecs_id_t _index, ecs_id_t _flag);
@@ -90,9 +93,17 @@ namespace mkr {
 
         std::size_t num_alive() const { return num_alive_; }
 
+        /// The number of ids that can still be created, either recycled or new.
+        std::size_t num_available() const { return num_free_ + (ECS_MAX_INDEX - id_counter_); }
+
         bool is_valid(ecs_id_t _id) const;
 
         ecs_id_t create_id();
+        /**
+         * Create up to _n ids at once. Recycled ids are handed out first, then new ids are generated in a single block.
+         * Fewer than _n ids are returned if the id space is exhausted.
+         */
+        std::vector<ecs_id_t> create_ids(std::size_t _n);
         bool destroy_id(ecs_id_t _id);
     };
 }
@@ -6,4 +6,10 @@ public:
     missing_component() : std::runtime_error("missing component") {}
     virtual ~missing_component() {}
 };
+
+class out_of_ids : public std::runtime_error {
+public:
+    out_of_ids() : std::runtime_error("out of ids") {}
+    virtual ~out_of_ids() {}
+};
 }
\ No newline at end of file
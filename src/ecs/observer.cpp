@@ -0,0 +1,51 @@
+#include "ecs/observer.h"
+
+namespace mkr {
+    const std::vector<observer_t>* observer_registry::find(component_event _event, component_id_t _comp_id) const {
+        const auto& observers = observers_[static_cast<std::size_t>(_event)];
+        auto iter = observers.find(_comp_id);
+        return iter == observers.end() ? nullptr : &iter->second;
+    }
+
+    void observer_registry::observe(component_event _event, component_id_t _comp_id, observer_t _observer) {
+        observers_[static_cast<std::size_t>(_event)][_comp_id].push_back(std::move(_observer));
+    }
+
+    void observer_registry::push(component_event _event, component_id_t _comp_id, ecs_id_t _entity) {
+        push(_event, _comp_id, std::span<const ecs_id_t>(&_entity, 1));
+    }
+
+    void observer_registry::push(component_event _event, component_id_t _comp_id, std::span<const ecs_id_t> _entities) {
+        if (_entities.empty() || !find(_event, _comp_id)) { return; }
+
+        auto& records = pending_[_comp_id];
+        if (records.empty()) { pending_types_.push_back(_comp_id); }
+        records.reserve(records.size() + _entities.size());
+        for (const auto& e : _entities) { records.push_back(record{_event, e}); }
+    }
+
+    void observer_registry::flush() {
+        // Swap the events out first, so that observers can safely raise new events.
+        std::unordered_map<component_id_t, std::vector<record>> pending;
+        std::vector<component_id_t> pending_types;
+        std::swap(pending, pending_);
+        std::swap(pending_types, pending_types_);
+
+        std::vector<ecs_id_t> batch;
+        for (const auto& comp_id : pending_types) {
+            const auto& records = pending.find(comp_id)->second;
+            for (std::size_t first = 0; first < records.size();) {
+                // Find the run of the same event on this component type.
+                const component_event event = records[first].event_;
+                batch.clear();
+                std::size_t last = first;
+                for (; last < records.size() && records[last].event_ == event; ++last) {
+                    batch.push_back(records[last].entity_);
+                }
+                first = last;
+
+                for (const auto& f : *find(event, comp_id)) { f(batch); }
+            }
+        }
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <span>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include "ecs/component_id.h"
+#include "ecs/ecs_id.h"
+
+namespace mkr {
+    enum class component_event : std::size_t {
+        add = 0,
+        remove,
+        set,
+        num_events,
+    };
+
+    /// An observer receives a batch of entities that raised an event on its component type.
+    typedef std::function<void(std::span<const ecs_id_t>)> observer_t;
+
+    /**
+     * Buffers component events and delivers them to observers in batches.
+     * Events are only buffered for component types that have at least one observer, so unobserved types cost a single lookup.
+     */
+    class observer_registry {
+    private:
+        struct record {
+            component_event event_;
+            ecs_id_t entity_;
+        };
+
+        /// For each event, the observers of each component type.
+        std::unordered_map<component_id_t, std::vector<observer_t>> observers_[static_cast<std::size_t>(component_event::num_events)];
+        /// The buffered events of each component type, in the order they were raised.
+        std::unordered_map<component_id_t, std::vector<record>> pending_;
+        /// The component types with buffered events, in the order their first event was raised.
+        std::vector<component_id_t> pending_types_;
+
+        const std::vector<observer_t>* find(component_event _event, component_id_t _comp_id) const;
+
+    public:
+        void observe(component_event _event, component_id_t _comp_id, observer_t _observer);
+
+        void push(component_event _event, component_id_t _comp_id, ecs_id_t _entity);
+        void push(component_event _event, component_id_t _comp_id, std::span<const ecs_id_t> _entities);
+
+        /**
+         * Deliver buffered events, one component type at a time, in the order they were raised on that type.
+         * The events of a component type are delivered as one batch per run of the same event,
+         * so events on different component types never split each other's batches.
+         * Events raised by observers during a flush are buffered until the next flush.
+         * Observers must not register new observers during a flush.
+         */
+        void flush();
+    };
+}
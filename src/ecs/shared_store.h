@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include <optional>
+
+namespace mkr {
+    /// Type-erased interface of shared_store, so that the world can release values without knowing their type.
+    class shared_store_base {
+    public:
+        virtual ~shared_store_base() {}
+
+        virtual void acquire(std::size_t _slot, std::size_t _count) = 0;
+        virtual void release(std::size_t _slot, std::size_t _count) = 0;
+
+        /// Create an empty store of the same type.
+        virtual shared_store_base* make() const = 0;
+        /// Copy the value in _slot of _src, which must be of the same type, into this store and acquire it _count times. Returns its slot in this store.
+        virtual std::size_t import(const shared_store_base& _src, std::size_t _slot, std::size_t _count) = 0;
+    };
+
+    /**
+     * Stores one copy of each distinct value of a shared component type.
+     * Each value lives in a slot, which is reference counted by the entities using it, and recycled once no entity does.
+     * Values are compared with operator==. Lookups are a linear scan, as there are expected to be few distinct values.
+     */
+    template<typename T>
+    class shared_store : public shared_store_base {
+    private:
+        std::vector<std::optional<T>> values_;
+        std::vector<std::size_t> ref_counts_;
+        std::vector<std::size_t> free_slots_;
+
+    public:
+        virtual ~shared_store() {}
+
+        /// Returns the slot holding _value, creating it with a reference count of 0 if there is none.
+        std::size_t find_or_insert(const T& _value) {
+            for (std::size_t slot = 0; slot < values_.size(); ++slot) {
+                if (values_[slot].has_value() && *values_[slot] == _value) { return slot; }
+            }
+
+            if (!free_slots_.empty()) {
+                const std::size_t slot = free_slots_.back();
+                free_slots_.pop_back();
+                values_[slot] = _value;
+                return slot;
+            }
+
+            values_.push_back(_value);
+            ref_counts_.push_back(0);
+            return values_.size() - 1;
+        }
+
+        const T& get(std::size_t _slot) const { return *values_[_slot]; }
+
+        std::size_t ref_count(std::size_t _slot) const { return ref_counts_[_slot]; }
+
+        void acquire(std::size_t _slot, std::size_t _count) override { ref_counts_[_slot] += _count; }
+
+        void release(std::size_t _slot, std::size_t _count) override {
+            ref_counts_[_slot] -= _count;
+            if (ref_counts_[_slot] == 0) {
+                values_[_slot].reset();
+                free_slots_.push_back(_slot);
+            }
+        }
+
+        shared_store_base* make() const override { return new shared_store<T>(); }
+
+        std::size_t import(const shared_store_base& _src, std::size_t _slot, std::size_t _count) override {
+            const std::size_t slot = find_or_insert(static_cast<const shared_store<T>&>(_src).get(_slot));
+            acquire(slot, _count);
+            return slot;
+        }
+    };
+}
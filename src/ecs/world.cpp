@@ -3,25 +3,160 @@
 namespace mkr {
     world::world() {
         // Add empty archetype.
-        archetypes_.insert(std::pair(archetype_t{}, archetype::make()));
+        archetypes_.insert(std::pair(archetype_key_t{}, archetype::make()));
     }
 
     world::~world() {
         for (auto &iter: archetypes_) { delete iter.second; }
+        for (auto &iter: shared_stores_) { delete iter.second; }
+        for (auto &iter: indices_) {
+            for (auto index: iter.second) { delete index; }
+        }
     }
 
     ecs_id_t world::create_entity() {
         ecs_id_t ent = entities_.create_id();
-        archetype *arc = archetypes_[archetype_t{}];
+        archetype *arc = archetypes_[archetype_key_t{}];
         ent_to_arc_.insert(std::pair(ent, arc));
         arc->add(ent);
         return ent;
     }
 
     void world::destroy_entity(ecs_id_t _entity) {
-        entities_.destroy_id(_entity);
         archetype *arc = ent_to_arc_[_entity];
+        for (const auto &comp_id: arc->types()) {
+            notify_removing(comp_id, _entity, arc);
+            index_erase(comp_id, _entity);
+            observers_.push(component_event::remove, comp_id, _entity);
+        }
+        for (const auto &[comp_id, slot]: arc->shared()) { shared_stores_[comp_id]->release(slot, 1); }
         arc->remove(_entity);
         ent_to_arc_.erase(ent_to_arc_.find(_entity));
+        entities_.destroy_id(_entity);
+    }
+
+    std::vector<ecs_id_t> world::instantiate(ecs_id_t _prefab, std::size_t _n) {
+        auto iter = ent_to_arc_.find(_prefab);
+        if (iter == ent_to_arc_.end()) { return {}; }
+
+        if (entities_.num_available() < _n) { throw out_of_ids(); }
+
+        archetype *arc = iter->second;
+        std::vector<ecs_id_t> ents = entities_.create_ids(_n);
+        arc->clone(_prefab, ents);
+        ent_to_arc_.reserve(ent_to_arc_.size() + ents.size());
+        for (const auto &e: ents) { ent_to_arc_.insert(std::pair(e, arc)); }
+        for (const auto &comp_id: arc->types()) {
+            index_insert(comp_id, arc, ents);
+            observers_.push(component_event::add, comp_id, ents);
+        }
+        for (const auto &[comp_id, slot]: arc->shared()) { shared_stores_[comp_id]->acquire(slot, ents.size()); }
+        return ents;
+    }
+
+    void world::swap_buffers() {
+        for (auto &iter: archetypes_) {
+            archetype *arc = iter.second;
+            arc->swap_buffers([this, arc](component_id_t _comp_id, std::span<const ecs_id_t> _entities) {
+                // Only the written rows can have new keys.
+                index_insert(_comp_id, arc, _entities);
+                observers_.push(component_event::set, _comp_id, _entities);
+            });
+        }
+    }
+
+    std::unordered_map<ecs_id_t, ecs_id_t> world::merge(world &&_staging) {
+        std::unordered_map<ecs_id_t, ecs_id_t> remap;
+        if (&_staging == this) { return remap; }
+
+        // Check that there are enough ids before changing anything, so that running out of ids leaves both worlds untouched.
+        const std::size_t num_ents = _staging.ent_to_arc_.size();
+        if (entities_.num_available() < num_ents) { throw out_of_ids(); }
+        std::vector<ecs_id_t> new_ids = entities_.create_ids(num_ents);
+        remap.reserve(num_ents);
+        ent_to_arc_.reserve(ent_to_arc_.size() + num_ents);
+
+        auto next_id = new_ids.begin();
+        for (auto iter = _staging.archetypes_.begin(); iter != _staging.archetypes_.end();) {
+            archetype *src_arc = iter->second;
+            if (src_arc->size() == 0) {
+                ++iter;
+                continue;
+            }
+
+            // Remap the entity ids.
+            std::vector<ecs_id_t> ents(next_id, next_id + src_arc->size());
+            next_id += src_arc->size();
+            for (std::size_t i = 0; i < ents.size(); ++i) { remap.insert(std::pair(src_arc->entities()[i], ents[i])); }
+
+            // Remap the shared component values to slots in this world.
+            shared_t shared;
+            for (const auto &[comp_id, slot]: src_arc->shared()) {
+                const shared_store_base *src_store = _staging.shared_stores_[comp_id];
+                auto &store = shared_stores_[comp_id];
+                if (!store) { store = src_store->make(); }
+                shared[comp_id] = store->import(*src_store, slot, ents.size());
+            }
+
+            // Splice the components into a matching archetype, or adopt the whole archetype if there is none.
+            archetype_key_t key{src_arc->types(), shared};
+            archetype *dst_arc = nullptr;
+            if (auto dst_iter = archetypes_.find(key); dst_iter != archetypes_.end()) {
+                dst_arc = dst_iter->second;
+                dst_arc->splice(src_arc, ents);
+                ++iter;
+            } else {
+                dst_arc = src_arc;
+                dst_arc->rename(ents, shared);
+                archetypes_.insert(std::pair(key, dst_arc));
+                iter = _staging.archetypes_.erase(iter);
+            }
+
+            for (const auto &e: ents) { ent_to_arc_.insert(std::pair(e, dst_arc)); }
+            for (const auto &comp_id: dst_arc->types()) {
+                index_insert(comp_id, dst_arc, ents);
+                observers_.push(component_event::add, comp_id, ents);
+            }
+        }
+        _staging.ent_to_arc_.clear();
+
+        return remap;
+    }
+
+    void world::repartition(ecs_id_t _entity, const shared_t &_shared) {
+        archetype *curr_arc = ent_to_arc_[_entity];
+        archetype_key_t new_key{curr_arc->types(), _shared};
+        if (auto iter = archetypes_.find(new_key); iter == archetypes_.end()) {
+            archetypes_[new_key] = curr_arc->partition_to(_shared);
+        }
+        auto new_arc = archetypes_[new_key];
+
+        // Move entity from current to new archetype.
+        curr_arc->move_to(_entity, new_arc);
+        ent_to_arc_[_entity] = new_arc;
+    }
+
+    void world::index_insert(component_id_t _comp_id, const archetype *_arc, std::span<const ecs_id_t> _entities) {
+        auto iter = indices_.find(_comp_id);
+        if (iter == indices_.end()) { return; }
+        for (auto index: iter->second) {
+            for (const auto &e: _entities) { index->insert(e, _arc); }
+        }
+    }
+
+    void world::notify_removing(component_id_t _comp_id, ecs_id_t _entity, const archetype *_arc) {
+        auto iter = removing_hooks_.find(_comp_id);
+        if (iter == removing_hooks_.end()) { return; }
+        for (const auto &f: iter->second) { f(_entity, _arc); }
+    }
+
+    void world::index_erase(component_id_t _comp_id, ecs_id_t _entity) {
+        auto iter = indices_.find(_comp_id);
+        if (iter == indices_.end()) { return; }
+        for (auto index: iter->second) { index->erase(_entity); }
+    }
+
+    void world::flush_events() {
+        observers_.flush();
     }
 }
\ No newline at end of file
@@ -5,19 +5,65 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <queue>
+#include <vector>
 #include <functional>
+#include <type_traits>
 #include <stdexcept>
 #include "ecs/ecs_id.h"
 #include "ecs/component_id.h"
 #include "ecs/archetype.h"
+#include "ecs/observer.h"
+#include "ecs/component_index.h"
+#include "ecs/shared_store.h"
 #include "ecs/exception.h"
 
 namespace mkr {
     class world {
+        template<typename T>
+        friend class component_ref;
+
     private:
         ecs_id entities_;
-        std::map<archetype_t, archetype*> archetypes_;
+        std::map<archetype_key_t, archetype*> archetypes_;
         std::unordered_map<ecs_id_t, archetype*> ent_to_arc_; /// Maps an entity to its archetype.
+        observer_registry observers_;
+        /// Hooks called synchronously, while the component is still readable, before an entity loses a component of each type.
+        std::unordered_map<component_id_t, std::vector<std::function<void(ecs_id_t, const archetype *)>>> removing_hooks_;
+        std::unordered_map<component_id_t, std::vector<component_index*>> indices_; /// The secondary indices of each component type.
+        std::unordered_map<component_id_t, shared_store_base*> shared_stores_; /// The distinct values of each shared component type.
+
+        /// Call the removing hooks of component type _comp_id on _entity, which is in _arc.
+        void notify_removing(component_id_t _comp_id, ecs_id_t _entity, const archetype *_arc);
+        /// Insert or update _entities in every index of component type _comp_id.
+        void index_insert(component_id_t _comp_id, const archetype *_arc, std::span<const ecs_id_t> _entities);
+        /// Remove _entity from every index of component type _comp_id.
+        void index_erase(component_id_t _comp_id, ecs_id_t _entity);
+
+        template<typename Index>
+        Index &create_index(Index *_index, component_id_t _comp_id) {
+            // Index the entities that already have the component.
+            for (const auto &[key, arc]: archetypes_) {
+                if (!key.first.contains(_comp_id)) { continue; }
+                for (const auto &e: arc->entities()) { _index->insert(e, arc); }
+            }
+            indices_[_comp_id].push_back(_index);
+            return *_index;
+        }
+
+        template<typename T>
+        shared_store<T> &shared_store_of() {
+            auto &store = shared_stores_[component_id::value<T>()];
+            if (!store) { store = new shared_store<T>(); }
+            return *static_cast<shared_store<T> *>(store);
+        }
+
+        template<typename T>
+        const shared_store<T> &shared_store_of() const {
+            return *static_cast<const shared_store<T> *>(shared_stores_.find(component_id::value<T>())->second);
+        }
+
+        /// Move _entity from its current archetype to the archetype with the same types as it, but with the shared values _shared.
+        void repartition(ecs_id_t _entity, const shared_t &_shared);
 
     public:
         world();
@@ -28,6 +74,28 @@ namespace mkr {
 
         void destroy_entity(ecs_id_t _id);
 
+        /**
+         * Create _n entities in the archetype of _prefab, each with a copy of all of _prefab's components.
+         * Returns the new entities, or none if _prefab does not exist. Throws out_of_ids, without creating any entity, if there are fewer than _n ids left.
+         */
+        std::vector<ecs_id_t> instantiate(ecs_id_t _prefab, std::size_t _n);
+
+        /**
+         * Swap the front and back buffers of every double buffered component. See archetype::swap_buffers.
+         * The entities written since the last swap are re-keyed in the indices of their component, and raise on_set events.
+         * This costs O(rows) of double buffered components, to carry forward the rows that were not written.
+         */
+        void swap_buffers();
+
+        /**
+         * Move every entity of _staging into this world, e.g. after populating _staging on another thread.
+         * Each entity is given a new id. Whole component arrays are moved per archetype, and archetypes that this world does not have yet are adopted as they are.
+         * Indices and add observers of this world are updated; those of _staging are not carried over.
+         * Returns a map from each entity's id in _staging to its id in this world. Throws out_of_ids, without merging anything, if there are not enough ids left.
+         * Afterwards, _staging may only be destroyed.
+         */
+        std::unordered_map<ecs_id_t, ecs_id_t> merge(world &&_staging);
+
         template<typename T>
         bool has_component(ecs_id_t _entity) const {
             auto iter = ent_to_arc_.find(_entity);
@@ -35,6 +103,7 @@ namespace mkr {
             return iter->second->has_type<T>();
         }
 
+        /// Double buffered components are read from their front buffer.
         template<typename T>
         const T &get_component(ecs_id_t _entity) const {
             // Ensure that entity exists and has component.
@@ -46,6 +115,43 @@ namespace mkr {
             return arc->get<T>(_entity);
         }
 
+        /**
+         * Double buffered components are written to their back buffer. Their indices are updated and their on_set events are raised by swap_buffers, once the value can be read.
+         * This raises an on_set event and updates indices, so it is not safe to call concurrently with any other world function. Concurrent systems should use write_component.
+         */
+        template<typename T>
+        world &set_component(ecs_id_t _entity, const T &_component) {
+            // Ensure that entity exists and has component.
+            if (!has_component<T>(_entity)) {
+                throw missing_component();
+            }
+
+            archetype *arc = ent_to_arc_.find(_entity)->second;
+            arc->set<T>(_entity, _component);
+            if constexpr (!double_buffered_v<T>) {
+                index_insert(component_id::value<T>(), arc, {&_entity, 1});
+                observers_.push(component_event::set, component_id::value<T>(), _entity);
+            }
+            return *this;
+        }
+
+        /**
+         * Write the double buffered component T of an entity to its back buffer. As with set_component, indices of T are updated and on_set events are raised by swap_buffers.
+         * This is safe to call concurrently with get_component, and with write_component on other entities,
+         * as long as no entity is created, destroyed or changes components at the same time.
+         */
+        template<typename T>
+        void write_component(ecs_id_t _entity, const T &_component) {
+            static_assert(double_buffered_v<T>, "write_component requires a double buffered component");
+
+            // Ensure that entity exists and has component.
+            if (!has_component<T>(_entity)) {
+                throw missing_component();
+            }
+
+            ent_to_arc_.find(_entity)->second->set<T>(_entity, _component);
+        }
+
         template<typename T>
         world &add_component(ecs_id_t _entity) {
             // Get current archetype.
@@ -55,16 +161,18 @@ namespace mkr {
             if (curr_arc->has_type<T>()) { return *this; }
 
             // Get new archetype.
-            archetype_t new_types = curr_arc->types();
-            new_types.insert(component_id::value<T>());
-            if (auto iter = archetypes_.find(new_types); iter == archetypes_.end()) {
-                archetypes_[new_types] = curr_arc->branch_to<T>();
+            archetype_key_t new_key = curr_arc->key();
+            new_key.first.insert(component_id::value<T>());
+            if (auto iter = archetypes_.find(new_key); iter == archetypes_.end()) {
+                archetypes_[new_key] = curr_arc->branch_to<T>();
             }
-            auto new_arc = archetypes_[new_types];
+            auto new_arc = archetypes_[new_key];
 
             // Move entity from current to new archetype.
             curr_arc->move_to(_entity, new_arc);
             ent_to_arc_[_entity] = new_arc;
+            index_insert(component_id::value<T>(), new_arc, {&_entity, 1});
+            observers_.push(component_event::add, component_id::value<T>(), _entity);
             return *this;
         }
 
@@ -75,16 +183,156 @@ namespace mkr {
 
             // If the entity does not have this component, do nothing.
             if (!curr_arc->has_type<T>()) { return *this; }
+            notify_removing(component_id::value<T>(), _entity, curr_arc);
+            index_erase(component_id::value<T>(), _entity);
+            observers_.push(component_event::remove, component_id::value<T>(), _entity);
 
             // Get new archetype.
-            archetype_t new_types = curr_arc->types();
-            new_types.erase(component_id::value<T>());
-            auto new_arc = archetypes_[new_types];
+            archetype_key_t new_key = curr_arc->key();
+            new_key.first.erase(component_id::value<T>());
+            if (auto iter = archetypes_.find(new_key); iter == archetypes_.end()) {
+                archetypes_[new_key] = curr_arc->prune_to<T>();
+            }
+            auto new_arc = archetypes_[new_key];
 
             // Move entity from current to new archetype.
             curr_arc->move_to(_entity, new_arc);
             ent_to_arc_[_entity] = new_arc;
             return *this;
         }
+
+        template<typename T>
+        bool has_shared(ecs_id_t _entity) const {
+            auto iter = ent_to_arc_.find(_entity);
+            if (iter == ent_to_arc_.end()) { return false; }
+            return iter->second->has_shared<T>();
+        }
+
+        template<typename T>
+        const T &get_shared(ecs_id_t _entity) const {
+            // Ensure that entity exists and has component.
+            if (!has_shared<T>(_entity)) {
+                throw missing_component();
+            }
+
+            const archetype *arc = ent_to_arc_.find(_entity)->second;
+            return shared_store_of<T>().get(arc->shared_slot<T>());
+        }
+
+        /**
+         * Set the shared component T of an entity, adding it if the entity does not have it yet.
+         * Shared components are stored once per distinct value, and entities are grouped into archetypes by their shared values.
+         * T must be equality comparable. Shared components are not seen by has_component, observers or indices.
+         */
+        template<typename T>
+        world &set_shared(ecs_id_t _entity, const T &_component) {
+            archetype *curr_arc = ent_to_arc_[_entity];
+            auto &store = shared_store_of<T>();
+            const std::size_t slot = store.find_or_insert(_component);
+
+            // If the entity already has this value, do nothing.
+            if (curr_arc->has_shared<T>() && curr_arc->shared_slot<T>() == slot) { return *this; }
+
+            store.acquire(slot, 1);
+            if (curr_arc->has_shared<T>()) { store.release(curr_arc->shared_slot<T>(), 1); }
+
+            shared_t new_shared = curr_arc->shared();
+            new_shared[component_id::value<T>()] = slot;
+            repartition(_entity, new_shared);
+            return *this;
+        }
+
+        template<typename T>
+        world &remove_shared(ecs_id_t _entity) {
+            archetype *curr_arc = ent_to_arc_[_entity];
+
+            // If the entity does not have this component, do nothing.
+            if (!curr_arc->has_shared<T>()) { return *this; }
+
+            shared_store_of<T>().release(curr_arc->shared_slot<T>(), 1);
+            shared_t new_shared = curr_arc->shared();
+            new_shared.erase(component_id::value<T>());
+            repartition(_entity, new_shared);
+            return *this;
+        }
+
+        /**
+         * Call _func(const T &_value, std::span<const ecs_id_t> _entities) once for every archetype with the shared component T,
+         * so that entities sharing a value can be processed together.
+         */
+        template<typename T, typename F>
+        void each_shared(F _func) const {
+            const component_id_t comp_id = component_id::value<T>();
+            for (const auto &[key, arc]: archetypes_) {
+                auto iter = key.second.find(comp_id);
+                if (iter == key.second.end() || arc->size() == 0) { continue; }
+                _func(shared_store_of<T>().get(iter->second), std::span<const ecs_id_t>(arc->entities()));
+            }
+        }
+
+        /**
+         * Create a hash index for equality lookups on component T.
+         * _key_func computes the key from the component. It can be a pointer to a data member to index a single field, or std::identity to index the whole component.
+         * The index is owned by the world and is updated by add_component, set_component, remove_component, instantiate, merge and destroy_entity.
+         * Indices of double buffered components key on the front buffer, and are updated by swap_buffers instead of set_component.
+         */
+        template<typename T, typename F>
+        auto &create_hash_index(F _key_func) {
+            using key_t = std::decay_t<std::invoke_result_t<F, const T &>>;
+            return create_index(new hash_index<T, key_t>([f = std::move(_key_func)](const T &_c) { return key_t(std::invoke(f, _c)); }),
+                                component_id::value<T>());
+        }
+
+        /// Create a sorted index for range lookups on component T. See create_hash_index.
+        template<typename T, typename F>
+        auto &create_sorted_index(F _key_func) {
+            using key_t = std::decay_t<std::invoke_result_t<F, const T &>>;
+            return create_index(new sorted_index<T, key_t>([f = std::move(_key_func)](const T &_c) { return key_t(std::invoke(f, _c)); }),
+                                component_id::value<T>());
+        }
+
+        /// Observe entities gaining component T, either through add_component or instantiate.
+        template<typename T>
+        world &on_add(observer_t _observer) {
+            observers_.observe(component_event::add, component_id::value<T>(), std::move(_observer));
+            return *this;
+        }
+
+        /**
+         * Observe entities losing component T, either through remove_component or destroy_entity.
+         * The component is already gone when the observer is called. Use on_removing to read it during cleanup.
+         */
+        template<typename T>
+        world &on_remove(observer_t _observer) {
+            observers_.observe(component_event::remove, component_id::value<T>(), std::move(_observer));
+            return *this;
+        }
+
+        /**
+         * Call _hook(ecs_id_t _entity, const T &_component) immediately before an entity loses component T,
+         * either through remove_component or destroy_entity, so that the value can still be read.
+         * Unlike observers, hooks are called once per entity and are not batched. Hooks must not add or remove components.
+         */
+        template<typename T, typename F>
+        world &on_removing(F _hook) {
+            removing_hooks_[component_id::value<T>()].push_back([f = std::move(_hook)](ecs_id_t _entity, const archetype *_arc) {
+                f(_entity, _arc->get<T>(_entity));
+            });
+            return *this;
+        }
+
+        /// Observe set_component calls on component T. For double buffered components, the event is raised by swap_buffers, when the new value becomes readable.
+        template<typename T>
+        world &on_set(observer_t _observer) {
+            observers_.observe(component_event::set, component_id::value<T>(), std::move(_observer));
+            return *this;
+        }
+
+        /**
+         * Deliver all events raised since the last flush to their observers, in the order they were raised on each component type.
+         * Each component type gets one batch per run of the same event, regardless of events on other component types.
+         * Entities in a batch may have been destroyed or changed again since the event was raised.
+         */
+        void flush_events();
     };
 }
\ No newline at end of file
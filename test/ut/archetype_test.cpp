@@ -1,4 +1,5 @@
 #include <gtest/gtest.h>
+#include <string>
 #include "ecs/archetype.h"
 
 using namespace mkr;
@@ -20,6 +21,13 @@ struct baz {
     explicit baz(char _val) : val_(_val) {}
 };
 
+struct position {
+    float x_ = 0.0f;
+};
+
+template<>
+struct mkr::double_buffered<position> : std::true_type {};
+
 TEST(archetype, one) {
     auto arc = archetype::make<foo>();
 
@@ -230,4 +238,85 @@ TEST(archetype, move) {
 
     delete arc1;
     delete arc2;
-}
\ No newline at end of file
+}
+
+TEST(archetype, clone) {
+    struct name { std::string val_ = "none"; };
+    auto arc = archetype::make<foo, bar, name>();
+
+    mkr::ecs_id_t prefab = 100;
+    arc->add(prefab);
+    arc->set<foo>(prefab, foo{23});
+    arc->set<bar>(prefab, bar{12.7f});
+    arc->set<name>(prefab, name{"orc"});
+
+    std::vector<mkr::ecs_id_t> ents;
+    for (mkr::ecs_id_t e = 101; e < 111; ++e) { ents.push_back(e); }
+    arc->clone(prefab, ents);
+
+    for (auto e : ents) {
+        EXPECT_TRUE(arc->has_entity(e));
+        EXPECT_TRUE(arc->get<foo>(e).val_ == 23);
+        EXPECT_TRUE(arc->get<bar>(e).val_ == 12.7f);
+        EXPECT_TRUE(arc->get<name>(e).val_ == "orc");
+    }
+
+    // Clones are independent of the prefab and of each other.
+    arc->set<foo>(ents[3], foo{52});
+    arc->remove(ents[0]);
+    EXPECT_TRUE(arc->get<foo>(prefab).val_ == 23);
+    EXPECT_TRUE(arc->get<foo>(ents[3]).val_ == 52);
+    EXPECT_TRUE(arc->get<foo>(ents[9]).val_ == 23);
+    EXPECT_TRUE(arc->get<name>(ents[9]).val_ == "orc");
+
+    delete arc;
+}
+
+TEST(archetype, double_buffered) {
+    auto arc1 = archetype::make<foo, position>();
+    auto arc2 = archetype::make<position>();
+
+    mkr::ecs_id_t ent1 = 101;
+    mkr::ecs_id_t ent2 = 102;
+
+    arc1->add(ent1);
+    arc1->add(ent2);
+    arc1->set<position>(ent1, position{1.0f});
+    arc1->set<foo>(ent1, foo{23});
+
+    // Writes only become visible after swapping the buffers.
+    EXPECT_TRUE(arc1->get<position>(ent1).x_ == 0.0f);
+    EXPECT_TRUE(arc1->get_back<position>(ent1).x_ == 1.0f);
+    EXPECT_TRUE(arc1->get<foo>(ent1).val_ == 23);
+    arc1->swap_buffers();
+    EXPECT_TRUE(arc1->get<position>(ent1).x_ == 1.0f);
+    EXPECT_TRUE(arc1->get_back<position>(ent1).x_ == 0.0f);
+    EXPECT_TRUE(arc1->get<foo>(ent1).val_ == 23);
+
+    // Both buffers are kept when moving and removing entities.
+    arc1->set<position>(ent1, position{2.0f});
+    arc1->remove(ent2);
+    arc1->move_to(ent1, arc2);
+    EXPECT_TRUE(arc2->get<position>(ent1).x_ == 1.0f);
+    EXPECT_TRUE(arc2->get_back<position>(ent1).x_ == 2.0f);
+    arc2->swap_buffers();
+    EXPECT_TRUE(arc2->get<position>(ent1).x_ == 2.0f);
+
+    // Rows that are not written keep their latest value across swaps.
+    arc2->swap_buffers();
+    arc2->swap_buffers();
+    EXPECT_TRUE(arc2->get<position>(ent1).x_ == 2.0f);
+    EXPECT_TRUE(arc2->get_back<position>(ent1).x_ == 2.0f);
+
+    // Only the written rows are reported.
+    mkr::ecs_id_t ent3 = 103;
+    arc2->add(ent3);
+    arc2->set<position>(ent3, position{3.0f});
+    std::vector<mkr::ecs_id_t> written;
+    arc2->swap_buffers([&](mkr::component_id_t, std::span<const mkr::ecs_id_t> _ents) { written.assign(_ents.begin(), _ents.end()); });
+    EXPECT_TRUE(written == std::vector<mkr::ecs_id_t>{ent3});
+    EXPECT_TRUE(arc2->get<position>(ent3).x_ == 3.0f);
+
+    delete arc1;
+    delete arc2;
+}
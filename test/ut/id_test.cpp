@@ -84,4 +84,35 @@ TEST(ecs_id, recycle_order) {
     EXPECT_TRUE(test_ids.destroy_id(b));
     EXPECT_TRUE(test_ids.destroy_id(g));
     EXPECT_TRUE(test_ids.destroy_id(h));
-}
\ No newline at end of file
+}
+
+TEST(ecs_id, create_ids) {
+    auto test_ids = ecs_id();
+
+    auto a = test_ids.create_id();
+    auto b = test_ids.create_id();
+    EXPECT_TRUE(test_ids.destroy_id(a));
+
+    // Recycled ids are handed out before new ones.
+    auto ids = test_ids.create_ids(4);
+    EXPECT_TRUE(ids.size() == 4);
+    EXPECT_TRUE(ecs_id::index_of(ids[0]) == 0);
+    EXPECT_TRUE(ecs_id::generation_of(ids[0]) == 1);
+    EXPECT_TRUE(ecs_id::index_of(ids[1]) == 2);
+    EXPECT_TRUE(ecs_id::index_of(ids[2]) == 3);
+    EXPECT_TRUE(ecs_id::index_of(ids[3]) == 4);
+    for (auto x : ids) { EXPECT_TRUE(test_ids.is_valid(x)); }
+    EXPECT_TRUE(test_ids.is_valid(b));
+    EXPECT_TRUE(test_ids.num_alive() == 5);
+
+    EXPECT_TRUE(test_ids.num_available() == ECS_MAX_INDEX - 5);
+
+    // Only the remaining ids are returned once the id space is exhausted.
+    auto rest = test_ids.create_ids(ECS_MAX_INDEX);
+    EXPECT_TRUE(rest.size() == ECS_MAX_INDEX - 5);
+    EXPECT_TRUE(test_ids.create_id() == ecs_id::invalid_id);
+    EXPECT_TRUE(test_ids.num_available() == 0);
+
+    EXPECT_TRUE(test_ids.destroy_id(b));
+    EXPECT_TRUE(test_ids.num_available() == 1);
+}
@@ -1,6 +1,420 @@
 #include <gtest/gtest.h>
 #include "ecs/world.h"
+#include "ecs/component_ref.h"
+
+using namespace mkr;
+using namespace std;
+
+namespace {
+    struct foo { int val_ = 7; };
+    struct bar { float val_ = 54.0f; };
+    struct pos { int val_ = 0; };
+}
+
+template<>
+struct mkr::double_buffered<pos> : std::true_type {};
 
 TEST(world, add_remove) {
 
-}
\ No newline at end of file
+}
+
+TEST(world, instantiate) {
+    world w;
+    auto prefab = w.create_entity();
+    w.add_component<foo>(prefab).add_component<bar>(prefab);
+
+    auto ents = w.instantiate(prefab, 100);
+    EXPECT_TRUE(ents.size() == 100);
+    for (auto e : ents) {
+        EXPECT_TRUE(w.has_component<foo>(e));
+        EXPECT_TRUE(w.has_component<bar>(e));
+        EXPECT_TRUE(w.get_component<foo>(e).val_ == 7);
+        EXPECT_TRUE(w.get_component<bar>(e).val_ == 54.0f);
+    }
+
+    w.remove_component<bar>(ents[10]);
+    EXPECT_FALSE(w.has_component<bar>(ents[10]));
+    EXPECT_TRUE(w.has_component<bar>(ents[11]));
+
+    EXPECT_TRUE(w.instantiate(ecs_id::invalid_id, 10).empty());
+
+    // Nothing is created if there are not enough ids.
+    EXPECT_THROW(w.instantiate(prefab, ECS_MAX_INDEX), out_of_ids);
+    EXPECT_TRUE(w.instantiate(prefab, 1).size() == 1);
+}
+
+TEST(world, observers) {
+    world w;
+    std::vector<ecs_id_t> added, removed, set;
+    std::size_t num_add_batches = 0;
+    w.on_add<foo>([&](std::span<const ecs_id_t> _ents) {
+        ++num_add_batches;
+        added.insert(added.end(), _ents.begin(), _ents.end());
+    });
+    w.on_remove<foo>([&](std::span<const ecs_id_t> _ents) { removed.insert(removed.end(), _ents.begin(), _ents.end()); });
+    w.on_set<foo>([&](std::span<const ecs_id_t> _ents) { set.insert(set.end(), _ents.begin(), _ents.end()); });
+
+    auto prefab = w.create_entity();
+    w.add_component<foo>(prefab).add_component<bar>(prefab);
+    auto ents = w.instantiate(prefab, 10);
+    w.set_component<foo>(ents[2], foo{3});
+    w.set_component<bar>(ents[3], bar{3.0f});
+    w.remove_component<foo>(ents[4]);
+    w.destroy_entity(ents[5]);
+
+    // Nothing is delivered until the events are flushed.
+    EXPECT_TRUE(added.empty());
+    w.flush_events();
+
+    EXPECT_TRUE(num_add_batches == 1);
+    EXPECT_TRUE(added.size() == 11);
+    EXPECT_TRUE(set == std::vector<ecs_id_t>{ents[2]});
+    EXPECT_TRUE((removed == std::vector<ecs_id_t>{ents[4], ents[5]}));
+    EXPECT_TRUE(w.get_component<foo>(ents[2]).val_ == 3);
+
+    // Batches are only delivered once.
+    w.flush_events();
+    EXPECT_TRUE(num_add_batches == 1);
+}
+
+TEST(world, observer_order) {
+    world w;
+    std::vector<std::pair<component_event, ecs_id_t>> events;
+    w.on_add<foo>([&](std::span<const ecs_id_t> _ents) {
+        for (auto e: _ents) { events.emplace_back(component_event::add, e); }
+    });
+    w.on_remove<foo>([&](std::span<const ecs_id_t> _ents) {
+        for (auto e: _ents) { events.emplace_back(component_event::remove, e); }
+    });
+
+    auto e = w.create_entity();
+    w.add_component<foo>(e);
+    w.flush_events();
+    events.clear();
+
+    // Events are delivered in the order they were raised, so the last event matches the entity's state.
+    w.remove_component<foo>(e);
+    w.add_component<foo>(e);
+    w.flush_events();
+    EXPECT_TRUE(events.size() == 2);
+    EXPECT_TRUE(events[0] == std::pair(component_event::remove, e));
+    EXPECT_TRUE(events[1] == std::pair(component_event::add, e));
+    EXPECT_TRUE(w.has_component<foo>(e));
+}
+
+TEST(world, observer_batches) {
+    world w;
+    std::size_t num_batches = 0, num_foo = 0, num_bar = 0;
+    w.on_add<foo>([&](std::span<const ecs_id_t> _ents) {
+        ++num_batches;
+        num_foo += _ents.size();
+    });
+    w.on_add<bar>([&](std::span<const ecs_id_t> _ents) {
+        ++num_batches;
+        num_bar += _ents.size();
+    });
+    w.on_remove<foo>([&](std::span<const ecs_id_t>) { ++num_batches; });
+
+    // Events on different component types do not split each other's batches.
+    std::vector<ecs_id_t> ents;
+    for (int i = 0; i < 100; ++i) {
+        auto e = w.create_entity();
+        w.add_component<foo>(e).add_component<bar>(e);
+        ents.push_back(e);
+    }
+    w.flush_events();
+    EXPECT_TRUE(num_batches == 2);
+    EXPECT_TRUE(num_foo == 100);
+    EXPECT_TRUE(num_bar == 100);
+
+    // Only a change of event on the same component type does.
+    num_batches = 0;
+    w.remove_component<foo>(ents[0]);
+    w.add_component<bar>(ents[0]);
+    w.remove_component<foo>(ents[1]);
+    w.add_component<foo>(ents[0]);
+    w.add_component<foo>(ents[1]);
+    w.flush_events();
+    EXPECT_TRUE(num_batches == 2);
+}
+
+TEST(world, on_removing) {
+    world w;
+    std::vector<std::pair<ecs_id_t, int>> removed;
+    w.on_removing<foo>([&](ecs_id_t _entity, const foo &_foo) { removed.emplace_back(_entity, _foo.val_); });
+
+    auto a = w.create_entity();
+    auto b = w.create_entity();
+    w.add_component<foo>(a).add_component<foo>(b);
+    w.set_component(a, foo{1}).set_component(b, foo{2});
+
+    // The value is still readable when the hook is called, without flushing.
+    w.remove_component<foo>(a);
+    w.destroy_entity(b);
+    EXPECT_TRUE(removed.size() == 2);
+    EXPECT_TRUE(removed[0] == std::pair(a, 1));
+    EXPECT_TRUE(removed[1] == std::pair(b, 2));
+}
+
+TEST(world, indices) {
+    struct network_id { std::uint32_t val_ = 0; };
+    world w;
+    auto prefab = w.create_entity();
+    w.add_component<network_id>(prefab).add_component<foo>(prefab);
+    auto ents = w.instantiate(prefab, 20);
+
+    // Indices created after the entities still pick them up.
+    auto &by_net_id = w.create_hash_index<network_id>(&network_id::val_);
+    auto &by_foo = w.create_sorted_index<foo>([](const foo &_f) { return _f.val_; });
+    EXPECT_TRUE(by_net_id.size() == 21);
+    EXPECT_TRUE(by_net_id.find(0).size() == 21);
+
+    for (std::uint32_t i = 0; i < ents.size(); ++i) {
+        w.set_component(ents[i], network_id{i + 100});
+        w.set_component(ents[i], foo{static_cast<int>(i)});
+    }
+    EXPECT_TRUE(by_net_id.find_one(105) == ents[5]);
+    EXPECT_TRUE(by_net_id.find_one(999) == ecs_id::invalid_id);
+    EXPECT_TRUE((by_foo.range(3, 5) == std::vector<ecs_id_t>{ents[3], ents[4], ents[5]}));
+
+    // Migrating keeps the entity indexed, removing the component or destroying the entity does not.
+    w.add_component<bar>(ents[5]);
+    EXPECT_TRUE(by_net_id.find_one(105) == ents[5]);
+    w.remove_component<network_id>(ents[5]);
+    EXPECT_TRUE(by_net_id.find_one(105) == ecs_id::invalid_id);
+    w.destroy_entity(ents[4]);
+    EXPECT_TRUE((by_foo.range(3, 5) == std::vector<ecs_id_t>{ents[3], ents[5]}));
+    w.add_component<network_id>(ents[5]);
+    EXPECT_TRUE(by_net_id.find(0).size() == 2);
+}
+
+TEST(world, index_rekey) {
+    struct network_id { std::uint32_t val_ = 0; };
+    world w;
+    auto prefab = w.create_entity();
+    w.add_component<network_id>(prefab);
+    auto &by_net_id = w.create_hash_index<network_id>(&network_id::val_);
+
+    // Every clone starts with the same key, and is then given its own.
+    auto ents = w.instantiate(prefab, 200);
+    EXPECT_TRUE(by_net_id.find(0).size() == 201);
+    for (std::uint32_t i = 0; i < ents.size(); ++i) { w.set_component(ents[i], network_id{i + 1}); }
+
+    EXPECT_TRUE(by_net_id.size() == 201);
+    EXPECT_TRUE(by_net_id.find(0) == std::vector<ecs_id_t>{prefab});
+    for (std::uint32_t i = 0; i < ents.size(); ++i) {
+        EXPECT_TRUE(by_net_id.find_one(i + 1) == ents[i]);
+        EXPECT_TRUE(by_net_id.find(i + 1).size() == 1);
+    }
+
+    // Setting the same key again, or removing from the middle of a key's entities, keeps the index consistent.
+    w.set_component(ents[5], network_id{6});
+    EXPECT_TRUE(by_net_id.find_one(6) == ents[5]);
+    for (std::uint32_t i = 10; i < 20; ++i) { w.set_component(ents[i], network_id{1000}); }
+    w.destroy_entity(ents[12]);
+    w.set_component(ents[10], network_id{11});
+    auto thousand = by_net_id.find(1000);
+    EXPECT_TRUE(thousand.size() == 8);
+    EXPECT_TRUE(std::set<ecs_id_t>(thousand.begin(), thousand.end()).size() == 8);
+    EXPECT_TRUE(by_net_id.find_one(11) == ents[10]);
+
+    // Keys with no entities left are dropped.
+    w.destroy_entity(ents[0]);
+    EXPECT_TRUE(by_net_id.find(1).empty());
+    EXPECT_TRUE(by_net_id.find_one(1) == ecs_id::invalid_id);
+}
+
+TEST(world, shared) {
+    struct material {
+        int id_ = 0;
+        bool operator==(const material &) const = default;
+    };
+    world w;
+    auto prefab = w.create_entity();
+    w.add_component<foo>(prefab);
+    w.set_shared(prefab, material{1});
+    auto ents = w.instantiate(prefab, 10);
+    w.set_shared(ents[0], material{2});
+    w.set_shared(ents[1], material{2});
+    w.set_component(ents[1], foo{5});
+
+    EXPECT_TRUE(w.has_shared<material>(ents[2]));
+    EXPECT_FALSE(w.has_component<material>(ents[2]));
+    EXPECT_TRUE(w.get_shared<material>(ents[2]).id_ == 1);
+    EXPECT_TRUE(w.get_shared<material>(ents[1]).id_ == 2);
+    EXPECT_TRUE(w.get_component<foo>(ents[1]).val_ == 5);
+    EXPECT_TRUE(&w.get_shared<material>(ents[0]) == &w.get_shared<material>(ents[1]));
+
+    // Adding a component keeps the shared value.
+    w.add_component<bar>(ents[1]);
+    EXPECT_TRUE(w.get_shared<material>(ents[1]).id_ == 2);
+
+    std::size_t num_one = 0, num_two = 0;
+    w.each_shared<material>([&](const material &_m, std::span<const ecs_id_t> _ents) {
+        (_m.id_ == 1 ? num_one : num_two) += _ents.size();
+    });
+    EXPECT_TRUE(num_one == 9);
+    EXPECT_TRUE(num_two == 2);
+
+    w.remove_shared<material>(ents[0]);
+    w.destroy_entity(ents[1]);
+    EXPECT_FALSE(w.has_shared<material>(ents[0]));
+    EXPECT_THROW(w.get_shared<material>(ents[0]), missing_component);
+    EXPECT_TRUE(w.get_component<foo>(ents[0]).val_ == 7);
+
+    // The slot of an unused value is recycled.
+    w.set_shared(ents[0], material{3});
+    EXPECT_TRUE(w.get_shared<material>(ents[0]).id_ == 3);
+    EXPECT_TRUE(w.get_shared<material>(ents[2]).id_ == 1);
+}
+
+TEST(world, merge) {
+    struct material {
+        int id_ = 0;
+        bool operator==(const material &) const = default;
+    };
+    world w;
+    auto a = w.create_entity();
+    w.add_component<foo>(a);
+    w.set_component(a, foo{1});
+    auto &by_foo = w.create_hash_index<foo>(&foo::val_);
+    std::size_t num_added = 0;
+    w.on_add<bar>([&](std::span<const ecs_id_t> _ents) { num_added += _ents.size(); });
+
+    std::unordered_map<ecs_id_t, ecs_id_t> remap;
+    std::vector<ecs_id_t> staged;
+    {
+        world staging;
+        // Spliced into the existing archetype of a.
+        auto b = staging.create_entity();
+        staging.add_component<foo>(b);
+        staging.set_component(b, foo{2});
+        staged.push_back(b);
+        // Adopted as a new archetype.
+        auto c = staging.create_entity();
+        staging.add_component<foo>(c).add_component<bar>(c);
+        staging.set_component(c, foo{3}).set_component(c, bar{3.0f});
+        staging.set_shared(c, material{3});
+        staged.push_back(c);
+        // Components-less entities go to the empty archetype.
+        staged.push_back(staging.create_entity());
+
+        remap = w.merge(std::move(staging));
+    }
+
+    EXPECT_TRUE(remap.size() == 3);
+    std::set<ecs_id_t> ids{a};
+    for (auto e: staged) { ids.insert(remap[e]); }
+    EXPECT_TRUE(ids.size() == 4);
+
+    auto b = remap[staged[0]];
+    auto c = remap[staged[1]];
+    EXPECT_TRUE(w.get_component<foo>(a).val_ == 1);
+    EXPECT_TRUE(w.get_component<foo>(b).val_ == 2);
+    EXPECT_TRUE(w.get_component<foo>(c).val_ == 3);
+    EXPECT_TRUE(w.get_component<bar>(c).val_ == 3.0f);
+    EXPECT_TRUE(w.get_shared<material>(c).id_ == 3);
+    EXPECT_FALSE(w.has_component<foo>(remap[staged[2]]));
+    EXPECT_TRUE(by_foo.find_one(3) == c);
+
+    w.flush_events();
+    EXPECT_TRUE(num_added == 1);
+
+    // Nothing changes if there are not enough ids to merge.
+    {
+        world staging;
+        auto d = staging.create_entity();
+        staging.add_component<foo>(d);
+        auto clones = staging.instantiate(d, ECS_MAX_INDEX - 1);
+        const ecs_id_t next = w.create_entity();
+        w.destroy_entity(next);
+        EXPECT_THROW(w.merge(std::move(staging)), out_of_ids);
+        EXPECT_TRUE(staging.has_component<foo>(d));
+        EXPECT_TRUE(staging.has_component<foo>(clones.back()));
+        // The next id created is the one that would have been created before the merge.
+        const ecs_id_t after = w.create_entity();
+        EXPECT_TRUE(ecs_id::index_of(after) == ecs_id::index_of(next));
+        EXPECT_TRUE(ecs_id::generation_of(after) == ecs_id::generation_of(next) + 1);
+        w.destroy_entity(after);
+    }
+
+    // Merged entities behave like any other entity.
+    w.remove_component<foo>(c);
+    w.destroy_entity(b);
+    EXPECT_TRUE(w.get_component<bar>(c).val_ == 3.0f);
+    EXPECT_TRUE(w.get_component<foo>(a).val_ == 1);
+}
+
+TEST(world, component_ref) {
+    world w;
+    auto a = w.create_entity();
+    w.add_component<foo>(a);
+    w.set_component(a, foo{1});
+
+    component_ref<foo> ref(w, a);
+    EXPECT_TRUE(ref->val_ == 1);
+    w.set_component(a, foo{2});
+    EXPECT_TRUE(ref.get().val_ == 2);
+
+    // References are resolved again after the archetype changes.
+    auto others = w.instantiate(a, 50);
+    w.set_component(others[0], foo{3});
+    EXPECT_TRUE(ref->val_ == 2);
+    w.add_component<bar>(a);
+    EXPECT_TRUE((*ref).val_ == 2);
+    w.destroy_entity(others[1]);
+    EXPECT_TRUE(ref->val_ == 2);
+
+    w.remove_component<foo>(a);
+    EXPECT_THROW(ref.get(), missing_component);
+    w.destroy_entity(a);
+    EXPECT_THROW(ref.get(), missing_component);
+}
+
+TEST(world, double_buffered) {
+    world w;
+    auto a = w.create_entity();
+    w.add_component<pos>(a);
+    auto &by_pos = w.create_hash_index<pos>(&pos::val_);
+
+    std::vector<int> set_values;
+    w.on_set<pos>([&](std::span<const ecs_id_t> _ents) {
+        for (auto e: _ents) { set_values.push_back(w.get_component<pos>(e).val_); }
+    });
+
+    // Writes become readable, indexed and observed after swapping the buffers.
+    w.set_component(a, pos{1});
+    EXPECT_TRUE(w.get_component<pos>(a).val_ == 0);
+    EXPECT_TRUE(by_pos.find_one(0) == a);
+    w.flush_events();
+    EXPECT_TRUE(set_values.empty());
+    w.swap_buffers();
+    w.flush_events();
+    EXPECT_TRUE(set_values == std::vector<int>{1});
+    EXPECT_TRUE(w.get_component<pos>(a).val_ == 1);
+    EXPECT_TRUE(by_pos.find_one(1) == a);
+
+    // The value is kept by later swaps without writes.
+    w.swap_buffers();
+    w.swap_buffers();
+    w.flush_events();
+    EXPECT_TRUE(set_values.size() == 1);
+    EXPECT_TRUE(w.get_component<pos>(a).val_ == 1);
+    EXPECT_TRUE(by_pos.find_one(1) == a);
+
+    // Indices agree with get_component for clones and newly created indices.
+    auto clones = w.instantiate(a, 3);
+    auto &by_pos2 = w.create_sorted_index<pos>(&pos::val_);
+    EXPECT_TRUE(by_pos.find(1).size() == 4);
+    EXPECT_TRUE(by_pos2.range(1, 1).size() == 4);
+    for (auto e: clones) { EXPECT_TRUE(w.get_component<pos>(e).val_ == 1); }
+
+    w.write_component(clones[0], pos{5});
+    EXPECT_TRUE(w.get_component<pos>(clones[0]).val_ == 1);
+    w.swap_buffers();
+    EXPECT_TRUE(w.get_component<pos>(clones[0]).val_ == 5);
+    EXPECT_TRUE(by_pos.find_one(5) == clones[0]);
+    w.flush_events();
+    EXPECT_TRUE((set_values == std::vector<int>{1, 5}));
+    EXPECT_TRUE(by_pos.find(1).size() == 3);
+}